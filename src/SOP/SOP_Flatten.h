@@ -31,6 +31,9 @@
 #define __SOP_Flatten_h__
 
 #include <SOP/SOP_Node.h>
+#include <GA/GA_Types.h>
+#include <UT/UT_BoundingBox.h>
+#include <UT/UT_StringHolder.h>
 
 namespace HDK_Sample {
 class SOP_Flatten : public SOP_Node
@@ -45,18 +48,26 @@ public:
     OP_ERROR                     cookInputGroups(OP_Context &context, 
 						int alone = 0) override;
 
-    static PRM_Template		 myTemplateList[];
+    static PRM_Template		*buildTemplates();
     static OP_Node		*myConstructor(OP_Network*, const char *,
 							    OP_Operator *);
 
-protected:
-    /// Update disable and hidden states of parameters based on the value
-    /// of other parameters.
-    bool                         updateParmsFlags() override;
+    static const UT_StringHolder theSOPTypeName;
+
+    const SOP_NodeVerb          *cookVerb() const override;
 
+    /// Notes that a local variable was used, so that cookMySop can tell
+    /// whether the parameters have to be evaluated for every point.
+    bool                         evalVariableValue(fpreal &val, int index,
+						   int thread) override;
+    bool                         evalVariableValue(UT_String &val, int index,
+						   int thread) override;
+
+protected:
     const char                  *inputLabel(unsigned idx) const override;
 
-    /// Method to cook geometry for the SOP
+    /// Method to cook geometry for the SOP.  Unless the parameters use
+    /// local variables, this just delegates to the verb.
     OP_ERROR                     cookMySop(OP_Context &context) override;
 
     /// This method is used to generate geometry for a "guide".  It does
@@ -64,6 +75,13 @@ protected:
     OP_ERROR                     cookMyGuide1(OP_Context &context) override;
 
 private:
+    /// Returns true if evaluating the parameters for a point looks up any
+    /// local variables, like $PT or $TX.
+    bool                         usesLocalVariables(OP_Context &context);
+
+    /// Cooks by evaluating the parameters separately for every point.
+    OP_ERROR                     cookLocalVariables(OP_Context &context);
+
     void	getGroups(UT_String &str){ evalString(str, "group", 0, 0); }
     fpreal	DIST(fpreal t)		{ return evalFloat("dist", 0, t); }
     int		DIRPOP()		{ return evalInt("usedir", 0, 0); }
@@ -75,6 +93,18 @@ private:
     /// This is the group of geometry to be manipulated by this SOP and cooked
     /// by the method "cookInputGroups".
     const GA_PointGroup *myGroup;
+
+    /// Set when a local variable is evaluated.
+    bool                 myUsedLocalVar;
+
+    /// The bounds of the input, used to size the guide, and the input
+    /// they were computed from, so that they're only recomputed when the
+    /// input's P or topology change, rather than on every redraw.
+    UT_BoundingBox       myGuideBBox;
+    exint                myGuideDetailId;
+    GA_DataId            myGuidePId;
+    GA_DataId            myGuideTopologyId;
+    GA_DataId            myGuidePrimListId;
 };
 } // End HDK_Sample namespace
 
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2022
+ *	Side Effects Software Inc.  All rights reserved.
+ *
+ * Redistribution and use of Houdini Development Kit samples in source and
+ * binary forms, with or without modification, are permitted provided that the
+ * following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. The name of Side Effects Software may not be used to endorse or
+ *    promote products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SIDE EFFECTS SOFTWARE `AS IS' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN
+ * NO EVENT SHALL SIDE EFFECTS SOFTWARE BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *----------------------------------------------------------------------------
+ * Phase timings and counters shared by the verbs of the SOPs in this
+ * directory.  Each SOP is its own plugin, so this is all inline.
+ */
+
+#ifndef __SOP_HDKToolsPerf_h__
+#define __SOP_HDKToolsPerf_h__
+
+#include <GA/GA_Handle.h>
+#include <GU/GU_Detail.h>
+#include <OP/OP_Node.h>
+#include <SOP/SOP_NodeVerb.h>
+#include <UT/UT_Array.h>
+#include <UT/UT_Performance.h>
+#include <UT/UT_StringArray.h>
+#include <UT/UT_StringHolder.h>
+#include <UT/UT_WorkBuffer.h>
+#include <chrono>
+#include <string.h>
+
+namespace HDK_Sample {
+
+/// Records how long each phase of a cook takes, along with counters of the
+/// work done.  The phases are reported as events to the performance
+/// monitor while it's recording cook times, and, if requested, everything
+/// is written to the output as detail attributes named perf_time_<phase>,
+/// (in seconds), and perf_count_<counter>.
+///
+/// When neither is wanted, nothing is recorded, so that each phase and
+/// counter costs a single branch.  Phases and counters must only be
+/// started and added from the thread doing the cook; work done in parallel
+/// should be totalled before it's added.
+class SOP_HDKToolsPerf
+{
+public:
+    SOP_HDKToolsPerf(const SOP_NodeVerb::CookParms &cookparms,
+		     bool output_attribs)
+	: myGdp(cookparms.gdh().gdpNC())
+	, myMonitor(nullptr)
+	, myOutputAttribs(output_attribs)
+	, myStartMemory(0)
+    {
+	UT_Performance *monitor = UTgetPerformance();
+	if (monitor && monitor->isRecordingCookStats())
+	{
+	    myMonitor = monitor;
+	    if (cookparms.getNode())
+	    {
+		UT_String path;
+		cookparms.getNode()->getFullPath(path);
+		myObject = path;
+	    }
+	}
+	if (isEnabled())
+	    myStartMemory = myGdp->getMemoryUsage(true);
+    }
+
+    /// Adds the growth of the output, as bytes_allocated, and writes out
+    /// the detail attributes.
+    ~SOP_HDKToolsPerf()
+    {
+	if (!isEnabled())
+	    return;
+
+	int64 memory = myGdp->getMemoryUsage(true);
+	add("bytes_allocated", SYSmax(memory - myStartMemory, int64(0)));
+
+	if (myMonitor && myCounters.entries())
+	{
+	    // the monitor has no counters, so they go along with an empty
+	    // event of their own
+	    UT_WorkBuffer info;
+	    for (exint i = 0; i < myCounters.entries(); ++i)
+	    {
+		info.appendSprintf("%s%s=%lld", i ? ", " : "",
+				   myCounterNames(i).c_str(),
+				   (long long)myCounters(i));
+	    }
+	    int id = myMonitor->startEvent("counters", myObject.c_str(),
+					   true, info.buffer());
+	    myMonitor->stopEvent(id);
+	}
+
+	if (myOutputAttribs)
+	{
+	    UT_WorkBuffer name;
+	    for (exint i = 0; i < myPhases.entries(); ++i)
+	    {
+		name.sprintf("perf_time_%s", myPhaseNames(i).c_str());
+		GA_RWHandleD h(myGdp->addFloatTuple(GA_ATTRIB_DETAIL,
+			name.buffer(), 1, GA_Defaults(0.0), nullptr, nullptr,
+			GA_STORE_REAL64));
+		if (h.isValid())
+		{
+		    h.set(GA_DETAIL_OFFSET, myPhases(i));
+		    h.bumpDataId();
+		}
+	    }
+	    for (exint i = 0; i < myCounters.entries(); ++i)
+	    {
+		name.sprintf("perf_count_%s", myCounterNames(i).c_str());
+		GA_RWHandleID h(myGdp->addIntTuple(GA_ATTRIB_DETAIL,
+			name.buffer(), 1, GA_Defaults(0), nullptr, nullptr,
+			GA_STORE_INT64));
+		if (h.isValid())
+		{
+		    h.set(GA_DETAIL_OFFSET, myCounters(i));
+		    h.bumpDataId();
+		}
+	    }
+	}
+    }
+
+    bool	isEnabled() const { return myMonitor || myOutputAttribs; }
+
+    /// Adds n to the counter called name.
+    void	add(const char *name, exint n)
+    {
+	if (!isEnabled())
+	    return;
+	myCounters(find(myCounterNames, myCounters, name)) += n;
+    }
+
+    /// Destroys the detail attributes written by a previous cook, for
+    /// verbs that keep their output from one cook to the next.
+    static void	destroyAttributes(GU_Detail *gdp)
+    {
+	UT_StringArray names;
+	GA_Attribute *attrib;
+	GA_FOR_ALL_GLOBAL_ATTRIBUTES(gdp, attrib)
+	{
+	    if (!strncmp(attrib->getName().c_str(), "perf_", 5))
+		names.append(attrib->getName());
+	}
+	for (const UT_StringHolder &name : names)
+	    gdp->destroyAttribute(GA_ATTRIB_DETAIL, name);
+    }
+
+    /// Times a phase of the cook for as long as it's in scope.  Phases
+    /// with the same name, e.g. one per loop iteration, are totalled.
+    class Phase
+    {
+    public:
+	Phase(SOP_HDKToolsPerf &perf, const char *name)
+	    : myPerf(perf.isEnabled() ? &perf : nullptr)
+	    , myName(name)
+	    , myEventId(-1)
+	{
+	    if (!myPerf)
+		return;
+	    if (myPerf->myMonitor)
+	    {
+		myEventId = myPerf->myMonitor->startEvent(
+			name, myPerf->myObject.c_str());
+	    }
+	    myStart = std::chrono::steady_clock::now();
+	}
+	~Phase() { stop(); }
+
+	/// Ends the phase before it goes out of scope.
+	void	stop()
+	{
+	    if (!myPerf)
+		return;
+	    double seconds = std::chrono::duration<double>(
+		    std::chrono::steady_clock::now() - myStart).count();
+	    myPerf->myPhases(find(myPerf->myPhaseNames, myPerf->myPhases,
+				  myName)) += seconds;
+	    if (myPerf->myMonitor)
+		myPerf->myMonitor->stopEvent(myEventId);
+	    myPerf = nullptr;
+	}
+
+    private:
+	SOP_HDKToolsPerf		*myPerf;
+	const char			*myName;
+	int				 myEventId;
+	std::chrono::steady_clock::time_point myStart;
+    };
+
+private:
+    /// Returns the index of name, adding it with a value of zero if it
+    /// isn't there yet.  There are only a handful of names per cook.
+    template <typename T>
+    static exint	find(UT_StringArray &names, UT_Array<T> &values,
+			     const char *name)
+    {
+	for (exint i = 0; i < names.entries(); ++i)
+	{
+	    if (names(i) == name)
+		return i;
+	}
+	names.append(name);
+	return values.append(T(0));
+    }
+
+    GU_Detail		*myGdp;
+    UT_Performance	*myMonitor;
+    UT_StringHolder	 myObject;
+    bool		 myOutputAttribs;
+    int64		 myStartMemory;
+
+    UT_StringArray	 myPhaseNames;
+    UT_Array<double>	 myPhases;
+    UT_StringArray	 myCounterNames;
+    UT_Array<exint>	 myCounters;
+};
+
+} // End HDK_Sample namespace
+
+#endif
@@ -50,6 +50,11 @@ public:
     
     const SOP_NodeVerb *cookVerb() const override;
 
+    const char *inputLabel(unsigned idx) const override
+    {
+        return "Points to Copy Stars to";
+    }
+
 protected:
     SOP_Star(OP_Network *net, const char *name, OP_Operator *op)
         : SOP_Node(net, name, op)
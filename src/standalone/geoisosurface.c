@@ -1,7 +1,39 @@
-// When executed this simple programm generates an ISO surface 
+// When executed this simple programm generates an ISO surface
 // and saves it to a Houdini geometry file names sphere.bgeo
+//
+// The grid is split into bricks which are polygonized in parallel, so it
+// also scales to very large resolutions.  Bricks which cannot contain the
+// surface are skipped, and the triangles are written out in chunks, so
+// memory use grows with the size of the surface rather than the volume.
+// Neighbouring bricks sample their shared faces at exactly the same
+// positions, so the points on those faces are welded within each chunk,
+// leaving the surface connected everywhere except between chunks.
+//
+// Usage: geoisosurface [options]
+//	-r res		    Number of voxels along each axis (20)
+//	-b xmin ymin zmin xmax ymax zmax
+//			    Bounds to evaluate the iso-surface in (-1..1)
+//	-k size		    Number of voxels along each side of a brick (32)
+//	-l lipschitz	    Bound on how fast the density changes with
+//			    distance, used to skip empty bricks (1)
+//	-c triangles	    Number of triangles per output chunk (1000000)
+//	-o file		    Output file (sphere.bgeo).  If the surface needs
+//			    more than one chunk, the chunks are written to
+//			    file.0.bgeo, file.1.bgeo, ... instead.  Chunks
+//			    aren't welded to each other.
+#include <GA/GA_Iterator.h>
 #include <GU/GU_Detail.h>	// Houdini geometry utility library
+#include <UT/UT_Array.h>
+#include <UT/UT_ParallelUtil.h>
+#include <UT/UT_Thread.h>
+#include <UT/UT_UniquePtr.h>
+#include <UT/UT_WorkBuffer.h>
+#include <SYS/SYS_Math.h>
+#include <chrono>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace HDK_Sample {
 	static float
@@ -10,22 +42,295 @@ namespace HDK_Sample {
 		// Return the signed distance to the unit sphere
 		return 1 - P.length();
 	}
+
+	// Writes the chunks of triangles to disk as they fill up
+	class ChunkWriter
+	{
+	public:
+		// The bricks start at origin and are brick_extent apart,
+		// with points closer than tolerance on their faces welded.
+		ChunkWriter(const char *filename, exint max_triangles,
+			    const UT_Vector3 &origin,
+			    const UT_Vector3 &brick_extent, float tolerance)
+			: myFilename(filename)
+			, myMaxTriangles(max_triangles)
+			, myOrigin(origin)
+			, myBrickExtent(brick_extent)
+			, myTolerance(tolerance)
+			, myNumChunks(0)
+			, myNumTriangles(0)
+			, myOk(true)
+		{
+		}
+
+		// Adds the triangles of a brick.  A full chunk is only
+		// written out once there's more to add, so that a surface
+		// which exactly fills one chunk is still written to the
+		// plain file name.
+		void add(const GU_Detail &brick)
+		{
+			if (!brick.getNumPrimitives())
+				return;
+			if (myChunk.getNumPrimitives() >= myMaxTriangles)
+				flush(false);
+			myChunk.merge(brick);
+		}
+
+		// Writes out whatever is left
+		void finish()
+		{
+			if (myChunk.getNumPrimitives() || !myNumChunks)
+				flush(myNumChunks == 0);
+		}
+
+		exint numTriangles() const { return myNumTriangles; }
+		exint numChunks() const { return myNumChunks; }
+		bool ok() const { return myOk; }
+
+	private:
+		// Welds the points that neighbouring bricks of the chunk
+		// each created on their shared faces
+		void weld()
+		{
+			GA_PointGroup *faces = myChunk.newInternalPointGroup();
+			for (GA_Iterator it(myChunk.getPointRange());
+			     !it.atEnd(); ++it)
+			{
+				UT_Vector3 P = myChunk.getPos3(*it) - myOrigin;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					float t = P(axis) / myBrickExtent(axis);
+					float d = (t - SYSrint(t))
+						* myBrickExtent(axis);
+					if (SYSabs(d) <= myTolerance)
+					{
+						faces->addOffset(*it);
+						break;
+					}
+				}
+			}
+			if (!faces->isEmpty())
+				myChunk.fastConsolidatePoints(myTolerance, faces);
+			myChunk.destroyPointGroup(faces);
+		}
+
+		void flush(bool only_chunk)
+		{
+			weld();
+
+			UT_WorkBuffer filename;
+			if (only_chunk)
+				filename.strcpy(myFilename);
+			else
+			{
+				// Put the chunk number in front of the
+				// extension
+				const char *ext = strrchr(myFilename, '.');
+				const char *dir = strrchr(myFilename, '/');
+				if (!ext || (dir && ext < dir))
+					ext = myFilename + strlen(myFilename);
+				filename.strncpy(myFilename, ext - myFilename);
+				filename.appendSprintf(".%d%s",
+					(int)myNumChunks,
+					*ext ? ext : ".bgeo");
+			}
+
+			myNumTriangles += myChunk.getNumPrimitives();
+			if (!myChunk.save(filename.buffer(), NULL).success())
+			{
+				fprintf(stderr, "Unable to save %s\n",
+					filename.buffer());
+				myOk = false;
+			}
+			myChunk.clearAndDestroy();
+			++myNumChunks;
+		}
+
+		GU_Detail	 myChunk;
+		const char	*myFilename;
+		exint		 myMaxTriangles;
+		UT_Vector3	 myOrigin;
+		UT_Vector3	 myBrickExtent;
+		float		 myTolerance;
+		exint		 myNumChunks;
+		exint		 myNumTriangles;
+		bool		 myOk;
+	};
+}
+
+using namespace HDK_Sample;
+
+static void
+usage(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-r res] "
+		"[-b xmin ymin zmin xmax ymax zmax] [-k bricksize]\n"
+		"       [-l lipschitz] [-c triangles] [-o file]\n", program);
 }
 
 int
 main(int argc, char *argv[])
 {
-	GU_Detail		gdp;
 	UT_BoundingBox	bounds;
+	exint		res = 20;
+	exint		brick_size = 32;
+	float		lipschitz = 1;
+	exint		chunk_size = 1000000;
+	const char	*filename = "sphere.bgeo";
 
 	// Evaluate the iso-surface inside this bounding box
 	bounds.setBounds(-1, -1, -1, 1, 1, 1);
 
-	// Create an iso-surface
-	gdp.polyIsoSurface(HDK_Sample::densityFunction, NULL, bounds, 20, 20, 20);
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			res = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-b") && i + 6 < argc)
+		{
+			float b[6];
+			for (int j = 0; j < 6; ++j)
+				b[j] = atof(argv[++i]);
+			bounds.setBounds(b[0], b[1], b[2], b[3], b[4], b[5]);
+		}
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+			brick_size = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			lipschitz = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			chunk_size = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			filename = argv[++i];
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (res < 1 || brick_size < 1 || chunk_size < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
 
-	// Save to sphere.bgeo
-	gdp.save("sphere.bgeo", NULL);
+	auto start_time = std::chrono::steady_clock::now();
 
-	return 0;
-}
\ No newline at end of file
+	// Split the grid into bricks of brick_size voxels along each side
+	exint		nbricks_axis = (res + brick_size - 1) / brick_size;
+	exint		nbricks = nbricks_axis * nbricks_axis * nbricks_axis;
+	UT_Vector3	voxel_size = bounds.size() / float(res);
+
+	auto brickBounds = [&](exint brick, UT_BoundingBox &box,
+			       int divs[3])
+	{
+		exint idx[3] = { brick % nbricks_axis,
+				 (brick / nbricks_axis) % nbricks_axis,
+				 brick / (nbricks_axis * nbricks_axis) };
+		UT_Vector3 bmin, bmax;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			exint start = idx[axis] * brick_size;
+			exint end = SYSmin(start + brick_size, res);
+			divs[axis] = int(end - start);
+			bmin(axis) = bounds.minvec()(axis)
+				   + start * voxel_size(axis);
+			bmax(axis) = bounds.minvec()(axis)
+				   + end * voxel_size(axis);
+		}
+		box.setBounds(bmin.x(), bmin.y(), bmin.z(),
+			      bmax.x(), bmax.y(), bmax.z());
+	};
+
+	// The density can change by at most lipschitz * distance, and every
+	// point of a brick is within half its diagonal of one of its
+	// corners, so if all corners are on the same side and further than
+	// that from the surface, the brick can't contain any of it.
+	UT_Array<char> active(nbricks, nbricks);
+	UTparallelFor(UT_BlockedRange<exint>(0, nbricks),
+		[&](const UT_BlockedRange<exint> &r)
+		{
+			for (exint brick = r.begin(); brick < r.end(); ++brick)
+			{
+				UT_BoundingBox box;
+				int divs[3];
+				brickBounds(brick, box, divs);
+
+				float reach = lipschitz * 0.5f * box.size().length();
+				int inside = 0;
+				float nearest = SYS_FP32_MAX;
+				for (int c = 0; c < 8; ++c)
+				{
+					UT_Vector3 P(
+					    (c & 1) ? box.xmax() : box.xmin(),
+					    (c & 2) ? box.ymax() : box.ymin(),
+					    (c & 4) ? box.zmax() : box.zmin());
+					float d = densityFunction(P, NULL);
+					if (d > 0)
+						++inside;
+					nearest = SYSmin(nearest, SYSabs(d));
+				}
+				active(brick) = !((inside == 0 || inside == 8)
+						  && nearest > reach);
+			}
+		});
+
+	UT_Array<exint> active_bricks;
+	for (exint brick = 0; brick < nbricks; ++brick)
+	{
+		if (active(brick))
+			active_bricks.append(brick);
+	}
+
+	// Polygonize the active bricks in parallel batches, handing the
+	// triangles of each batch to the writer before starting the next,
+	// so only one batch of bricks is ever held in memory.
+	ChunkWriter	writer(filename, chunk_size, bounds.minvec(),
+			       voxel_size * float(brick_size),
+			       1e-4f * SYSmin(voxel_size.x(), voxel_size.y(),
+					      voxel_size.z()));
+	exint		batch_size = 4 * UT_Thread::getNumProcessors();
+	UT_Array<UT_UniquePtr<GU_Detail>> batch(batch_size, batch_size);
+	for (exint first = 0; first < active_bricks.entries(); first += batch_size)
+	{
+		exint n = SYSmin(batch_size, active_bricks.entries() - first);
+		UTparallelFor(UT_BlockedRange<exint>(0, n),
+			[&](const UT_BlockedRange<exint> &r)
+			{
+				for (exint i = r.begin(); i < r.end(); ++i)
+				{
+					UT_BoundingBox box;
+					int divs[3];
+					brickBounds(active_bricks(first + i), box, divs);
+
+					batch(i).reset(new GU_Detail);
+					batch(i)->polyIsoSurface(
+						densityFunction, NULL, box,
+						divs[0], divs[1], divs[2]);
+				}
+			});
+
+		for (exint i = 0; i < n; ++i)
+		{
+			writer.add(*batch(i));
+			batch(i).reset();
+		}
+	}
+	writer.finish();
+
+	double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start_time).count();
+	double nvoxels = double(res) * double(res) * double(res);
+	printf("Voxels:    %.0f (%lld of %lld bricks polygonized)\n",
+	       nvoxels, (long long)active_bricks.entries(),
+	       (long long)nbricks);
+	printf("Triangles: %lld in %lld chunk(s)\n",
+	       (long long)writer.numTriangles(),
+	       (long long)writer.numChunks());
+	printf("Time:      %.3f s\n", seconds);
+	if (seconds > 0)
+	{
+		printf("Rate:      %.4g voxels/s, %.4g triangles/s\n",
+		       nvoxels / seconds, writer.numTriangles() / seconds);
+	}
+
+	return writer.ok() ? 0 : 1;
+}